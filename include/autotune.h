@@ -0,0 +1,23 @@
+#pragma once
+#include "image.h"
+#include "model.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+struct TuningConfig {
+    size_t kernel_tile = 1;
+    int threads = 1;
+};
+
+// Micro-benchmarks the dense kernel tile (used by predict, fit and fit_hogwild) on the model's
+// layer shapes, then the fit_hogwild thread count with that tile, using sample as the workload.
+// fit() is single threaded so only the tile affects it. Batch size is left to the caller: it
+// changes how the model converges, not just its speed.
+TuningConfig autotune(const Model& model, const std::vector<LabeledImage>& sample);
+
+// Per-host cache file, one line per topology: "<784-16-16-10> <kernel_tile> <threads>".
+// Malformed or out of range lines are ignored.
+std::string tuning_cache_path(const std::string& dir);
+std::optional<TuningConfig> load_tuning(const std::string& path, const Model& model);
+void save_tuning(const std::string& path, const Model& model, const TuningConfig& config);
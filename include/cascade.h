@@ -0,0 +1,36 @@
+#pragma once
+#include "image.h"
+#include "model.h"
+#include <cstdint>
+#include <vector>
+
+// Two stage classifier: the fast model answers first and only predictions whose
+// top-1/top-2 margin is below the threshold are forwarded to the accurate model.
+// Only references to the two models are held, so they must outlive the cascade.
+class Cascade {
+public:
+    Cascade(const Model& fast, const Model& accurate, float threshold);
+    uint8_t predict(const Image& im) const;
+
+    float threshold() const { return threshold_; }
+    void set_threshold(float threshold) { threshold_ = threshold; }
+private:
+    const Model& fast_;
+    const Model& accurate_;
+    float threshold_;
+};
+
+struct CascadePoint {
+    float threshold;
+    float escalated;  // fraction of samples sent to the accurate model
+    float accuracy;   // percent
+    double mean_us;
+    double p99_us;
+};
+
+// Sweeps the escalation threshold over the test set. Each model is run once per sample
+// and the per-threshold latency is rebuilt from those timings, so the sweep is cheap.
+std::vector<CascadePoint> evaluate_cascade(
+    const Model& fast, const Model& accurate,
+    const std::vector<LabeledImage>& test, const std::vector<float>& thresholds
+);
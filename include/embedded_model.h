@@ -0,0 +1,42 @@
+#pragma once
+// Header-only inference over the weight table generated by embed_weights. The weights are
+// constexpr so they live in read-only memory and nothing is loaded at startup.
+#include "embedded_weights.h"
+#include "image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+
+namespace embedded_model {
+
+inline constexpr std::size_t max_layer_size = *std::max_element(std::begin(layer_sizes), std::end(layer_sizes));
+static_assert(layer_sizes[0] == IMAGE_SIZE, "embedded model must take a 28x28 image");
+
+inline float sigmoid(float z) { return 1 / (1 + std::exp(-z)); }
+
+inline uint8_t predict(const Image& image) {
+    float a[max_layer_size], next[max_layer_size];
+    std::copy(image, image + IMAGE_SIZE, a);
+
+    for (std::size_t l = 0; l < layer_count; ++l) {
+        const float* w = weights[l];
+        const float* b = biases[l];
+        std::size_t input_size = layer_sizes[l];
+        std::size_t output_size = layer_sizes[l + 1];
+
+        for (std::size_t j = 0; j < output_size; ++j) {
+            float z = b[j];
+            for (std::size_t k = 0; k < input_size; ++k) {
+                z += w[j * input_size + k] * a[k];
+            }
+            next[j] = sigmoid(z);
+        }
+        std::copy(next, next + output_size, a);
+    }
+
+    std::size_t outputs = layer_sizes[layer_count];
+    return static_cast<uint8_t>(std::max_element(a, a + outputs) - a);
+}
+
+} // namespace embedded_model
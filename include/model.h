@@ -1,7 +1,9 @@
 #pragma once
 #include "image.h"
+#include <algorithm>
 #include <cstdint>
 #include <initializer_list>
+#include <memory>
 #include <vector>
 
 enum class Activation {
@@ -15,6 +17,23 @@ struct LayerConfig {
     Activation activation;
 };
 
+// Top-1 digit together with how far ahead it is of the runner-up.
+struct Prediction {
+    uint8_t digit;
+    float margin; // top-1 score minus top-2 score
+};
+
+class PredictionCache;
+
+// Held-out validation run concurrently with fit() on a snapshot of the weights
+struct ValidationConfig {
+    const std::vector<LabeledImage>* data = nullptr; // null disables validation
+    int every_batches = 0; // validate every N batches, 0 uses every_epochs instead
+    int every_epochs = 1;  // validate every N epochs when every_batches is 0
+    int patience = 0;      // validations without improvement before stopping early, 0 never stops
+    bool restore_best = true;
+};
+
 struct TrainHistory {
     int epoch;
     float epoch_loss;
@@ -24,15 +43,67 @@ struct TrainHistory {
 class Model {
 public:
     Model(const std::initializer_list<LayerConfig>& config);
-    std::vector<TrainHistory> fit(const std::vector<LabeledImage>& train, int epochs, int batch_size, float learning_rate);
+    std::vector<TrainHistory> fit(const std::vector<LabeledImage>& train, int epochs, int batch_size, float learning_rate,
+        const ValidationConfig& validation = {});
+    // One gradient step over a small batch of new samples, in place and with no epoch or plateau
+    // state, so the cost is bounded by the batch size. Returns the mean loss of the batch.
+    float partial_fit(const std::vector<LabeledImage>& batch, float learning_rate);
+    // Hogwild style asynchronous SGD: each thread runs per-sample updates straight into the
+    // shared weights with relaxed atomics and no locks, lost updates are accepted. The forward pass
+    // uses the same kernel_tile() as fit(), reading the weights through relaxed atomic loads.
+    // threads <= 0 uses hogwild_threads().
+    std::vector<TrainHistory> fit_hogwild(const std::vector<LabeledImage>& train, int epochs, int threads, float learning_rate);
     uint8_t predict(const Image& im) const;
+    Prediction classify(const Image& im) const;
     void evaluate(const std::vector<LabeledImage>& test) const;
+    float accuracy(const std::vector<LabeledImage>& test) const;
+
+    // Memoise predictions for repeated images. Shared by copies of the model, entries are
+    // tagged with version() so any weight update invalidates them.
+    void enable_cache(size_t capacity, size_t shards = 16);
+    PredictionCache* cache() const { return cache_.get(); }
+    void disable_cache() { cache_.reset(); }
+    uint64_t version() const { return version_; }
+
+    // Number of output neurons the dense kernels compute per pass over the input: 1, 2, 4 or 8
+    void set_kernel_tile(size_t tile);
+    size_t kernel_tile() const { return kernelTile_; }
+    // Default worker count for fit_hogwild(), fit() is single threaded
+    void set_hogwild_threads(int threads) { hogwildThreads_ = std::max(threads, 1); }
+    int hogwild_threads() const { return hogwildThreads_; }
+    const std::vector<unsigned int>& layer_sizes() const { return layerSizes_; }
+
+    // Dense layer with sigmoid activation over a row-major [output x input] weight matrix
+    static void forwardLayer(const float* w, const float* b, const float* in, float* out, size_t input_size, size_t output_size, size_t tile);
 private:
+    // Scratch buffers for training: activations, deltas and gradient accumulators
+    struct Workspace {
+        std::vector<std::vector<float>> a;
+        std::vector<std::vector<float>> d;
+        std::vector<std::vector<float>> w_grad;
+        std::vector<std::vector<float>> b_grad;
+    };
+
+    Workspace makeWorkspace() const;
+    float trainSample(const LabeledImage& sample, Workspace& ws, bool& correct) const;
+    void applyGradients(Workspace& ws, float scaler);
+
+    Prediction classifyUncached(const Image& im) const;
+    void weightsChanged();
+    static void forwardLayerRelaxed(const float* w, const float* b, const float* in, float* out, size_t input_size, size_t output_size, size_t tile);
+    static void backwardLayer(const float* w, const float* a_in, const float* delta, size_t input_size, size_t output_size,
+        float* w_grad, float* b_grad, float* d_prev);
+    std::shared_ptr<const Model> snapshot() const;
+
     std::vector<float> forwardPass(const Image& image) const;
 
     std::vector<std::vector<float>> weights_;
     std::vector<std::vector<float>> biases_;
     std::vector<unsigned int> layerSizes_;
+    std::shared_ptr<PredictionCache> cache_;
+    uint64_t version_ = 0;
+    size_t kernelTile_ = 1;
+    int hogwildThreads_ = 1;
 
-    friend int main();
+    friend int main(int argc, char** argv);
 };
\ No newline at end of file
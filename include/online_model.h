@@ -0,0 +1,28 @@
+#pragma once
+#include "image.h"
+#include "model.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Serves predictions while partial_fit() applies streaming corrections. Updates go to a private
+// back buffer which is then published atomically, so a reader always sees one complete weight
+// version and never waits on the writer. A published buffer is never written again.
+class OnlineModel {
+public:
+    explicit OnlineModel(const Model& initial, size_t max_batch = 64);
+
+    // Snapshot for a consistent sequence of reads, stays valid after later updates
+    std::shared_ptr<const Model> current() const { return front_.load(std::memory_order_acquire); }
+    uint8_t predict(const Image& im) const { return current()->predict(im); }
+
+    // One gradient step over at most max_batch samples, then publishes the new weights.
+    // Writers are serialised. Returns the mean loss of the batch.
+    float partial_fit(const std::vector<LabeledImage>& batch, float learning_rate);
+private:
+    std::atomic<std::shared_ptr<Model>> front_;
+    std::shared_ptr<Model> back_;
+    std::mutex writer_;
+    size_t max_batch_;
+};
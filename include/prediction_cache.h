@@ -0,0 +1,53 @@
+#pragma once
+#include "image.h"
+#include "model.h"
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t size;
+};
+
+// Bounded LRU cache of predictions keyed by a hash of the pixels. Entries keep a full copy
+// of the image so a hash collision can never return the wrong digit, and are tagged with
+// the model version they were computed for so a weight update invalidates them.
+// Split into independently locked shards so concurrent callers rarely contend.
+class PredictionCache {
+public:
+    explicit PredictionCache(size_t capacity, size_t shards = 16);
+
+    static uint64_t hash(const Image& im);
+
+    std::optional<Prediction> lookup(const Image& im, uint64_t hash, uint64_t version);
+    void insert(const Image& im, uint64_t hash, uint64_t version, Prediction prediction);
+    void clear();
+    CacheStats stats() const;
+private:
+    struct Entry {
+        std::array<float, IMAGE_SIZE> pixels;
+        uint64_t hash;
+        uint64_t version;
+        Prediction prediction;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru; // most recently used at the front
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        uint64_t hits = 0, misses = 0, evictions = 0;
+    };
+
+    Shard& shard_for(uint64_t hash) { return shards_[(hash >> 32) % shard_count_]; }
+
+    size_t shard_capacity_;
+    size_t shard_count_;
+    std::unique_ptr<Shard[]> shards_;
+};
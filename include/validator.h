@@ -0,0 +1,48 @@
+#pragma once
+#include "image.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Model;
+
+// Scores weight snapshots on a held-out set from a background thread so validation overlaps
+// with training. Only the newest submitted snapshot is kept, the trainer never waits on it.
+class AsyncValidator {
+public:
+    // patience: validations without improvement before should_stop() turns true, 0 disables early stopping
+    AsyncValidator(const std::vector<LabeledImage>& data, int patience);
+    ~AsyncValidator();
+
+    void submit(std::shared_ptr<const Model> snapshot, int epoch, int batch);
+    bool should_stop() const;
+
+    // Validates whatever is still pending, stops the thread and returns the best snapshot seen (may be null)
+    std::shared_ptr<const Model> finish();
+    float best_accuracy() const;
+private:
+    struct Job {
+        std::shared_ptr<const Model> snapshot;
+        int epoch;
+        int batch;
+    };
+
+    void run();
+
+    const std::vector<LabeledImage>& data_;
+    int patience_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    Job pending_{};
+    bool done_ = false;
+    bool stop_ = false;
+
+    std::shared_ptr<const Model> best_;
+    float best_acc_ = -1.0f;
+    int no_improve_ = 0;
+
+    std::thread thread_;
+};
@@ -0,0 +1,137 @@
+#include "autotune.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <print>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+static std::string topology_key(const Model& model) {
+    std::string key;
+    for (unsigned int size : model.layer_sizes()) {
+        if (!key.empty()) key += '-';
+        key += std::to_string(size);
+    }
+    return key;
+}
+
+template <typename F>
+static double seconds(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Best of a few repeats, the first run also warms the caches
+template <typename F>
+static double best_of(int repeats, F&& f) {
+    double best = seconds(f);
+    for (int i = 1; i < repeats; ++i) best = std::min(best, seconds(f));
+    return best;
+}
+
+TuningConfig autotune(const Model& model, const std::vector<LabeledImage>& sample) {
+    TuningConfig best;
+    if (sample.empty()) return best;
+    double n = static_cast<double>(sample.size());
+
+    std::println("Autotuning {} on {} samples...", topology_key(model), sample.size());
+
+    // Time the dense kernel alone on preallocated buffers shaped like the model's layers, so
+    // allocation and bookkeeping in the prediction path do not hide the tile differences.
+    const auto& sizes = model.layer_sizes();
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> dist(-0.1f, 0.1f);
+    std::vector<std::vector<float>> w(sizes.size() - 1), b(sizes.size() - 1), a(sizes.size());
+    for (size_t l = 0; l < sizes.size(); ++l) a[l].resize(sizes[l]);
+    for (size_t l = 0; l + 1 < sizes.size(); ++l) {
+        w[l].resize(sizes[l] * sizes[l + 1]);
+        b[l].resize(sizes[l + 1]);
+        for (auto& x : w[l]) x = dist(gen);
+        for (auto& x : b[l]) x = dist(gen);
+    }
+
+    double best_time = 0.0;
+    for (size_t tile : {1, 2, 4, 8}) {
+        double t = best_of(5, [&] {
+            for (const auto& s : sample) {
+                std::copy(s.image, s.image + IMAGE_SIZE, a[0].data());
+                for (size_t l = 0; l < w.size(); ++l) {
+                    Model::forwardLayer(w[l].data(), b[l].data(), a[l].data(), a[l + 1].data(), sizes[l], sizes[l + 1], tile);
+                }
+            }
+        });
+        std::println("Kernel tile: {} | Samples/sec: {:.0f}", tile, n / t);
+        if (best_time == 0.0 || t < best_time) {
+            best_time = t;
+            best.kernel_tile = tile;
+        }
+    }
+
+    // The thread count only applies to fit_hogwild, which runs the tiled kernel chosen above
+    Model bench = model;
+    bench.disable_cache();
+    bench.set_kernel_tile(best.kernel_tile);
+
+    best_time = 0.0;
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        Model m = bench;
+        double t = best_of(3, [&] { m.fit_hogwild(sample, 1, threads, 0.1f); });
+        std::println("Threads: {} | Samples/sec: {:.0f}", threads, n / t);
+        if (best_time == 0.0 || t < best_time) {
+            best_time = t;
+            best.threads = threads;
+        }
+    }
+
+    std::println("Tuned | Kernel tile: {} | Threads: {}", best.kernel_tile, best.threads);
+    return best;
+}
+
+std::string tuning_cache_path(const std::string& dir) {
+    char host[256] = {};
+    if (gethostname(host, sizeof(host) - 1) != 0 || host[0] == '\0') return dir + "/tuning.cache";
+    return dir + "/tuning." + host + ".cache";
+}
+
+std::optional<TuningConfig> load_tuning(const std::string& path, const Model& model) {
+    std::ifstream file(path);
+    if (!file.is_open()) return std::nullopt;
+
+    std::string key = topology_key(model);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string topology, extra;
+        long long tile = 0, threads = 0;
+        if (!(fields >> topology >> tile >> threads) || fields >> extra) continue;
+        if (topology != key) continue;
+        if (tile != 1 && tile != 2 && tile != 4 && tile != 8) continue;
+        if (threads <= 0 || threads > 4096) continue;
+        return TuningConfig{static_cast<size_t>(tile), static_cast<int>(threads)};
+    }
+    return std::nullopt;
+}
+
+void save_tuning(const std::string& path, const Model& model, const TuningConfig& config) {
+    // keep the entries for other topologies
+    std::string key = topology_key(model);
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line.starts_with(key + ' ')) continue;
+            lines.push_back(line);
+        }
+    }
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) throw std::runtime_error("Unable to write tuning cache " + path);
+    for (const auto& line : lines) file << line << '\n';
+    file << key << ' ' << config.kernel_tile << ' ' << config.threads << '\n';
+}
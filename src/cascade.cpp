@@ -0,0 +1,71 @@
+#include "cascade.h"
+#include <algorithm>
+#include <chrono>
+#include <print>
+
+// The escalation rule shared by Cascade::predict and the threshold sweep
+static bool escalates(const Prediction& fast, float threshold) {
+    return fast.margin < threshold;
+}
+
+Cascade::Cascade(const Model& fast, const Model& accurate, float threshold)
+    : fast_(fast), accurate_(accurate), threshold_(threshold) {}
+
+uint8_t Cascade::predict(const Image& im) const {
+    Prediction p = fast_.classify(im);
+    if (!escalates(p, threshold_)) return p.digit;
+    return accurate_.predict(im);
+}
+
+std::vector<CascadePoint> evaluate_cascade(
+    const Model& fast, const Model& accurate,
+    const std::vector<LabeledImage>& test, const std::vector<float>& thresholds
+) {
+    using clock = std::chrono::steady_clock;
+    size_t n = test.size();
+    std::vector<CascadePoint> points;
+    if (n == 0) return points;
+
+    std::vector<Prediction> fast_pred(n);
+    std::vector<uint8_t> accurate_pred(n);
+    std::vector<double> fast_us(n), accurate_us(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        auto t0 = clock::now();
+        fast_pred[i] = fast.classify(test[i].image);
+        auto t1 = clock::now();
+        accurate_pred[i] = accurate.predict(test[i].image);
+        auto t2 = clock::now();
+        fast_us[i] = std::chrono::duration<double, std::micro>(t1 - t0).count();
+        accurate_us[i] = std::chrono::duration<double, std::micro>(t2 - t1).count();
+    }
+
+    std::println("Threshold | Escalated | Accuracy | Mean (us) | p99 (us)");
+    std::vector<double> latency(n);
+    points.reserve(thresholds.size());
+    for (float threshold : thresholds) {
+        size_t escalated = 0, correct = 0;
+        double total_us = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            bool escalate = escalates(fast_pred[i], threshold);
+            uint8_t pred = escalate ? accurate_pred[i] : fast_pred[i].digit;
+            latency[i] = fast_us[i] + (escalate ? accurate_us[i] : 0.0);
+            total_us += latency[i];
+            if (escalate) escalated++;
+            if (pred == test[i].label) correct++;
+        }
+
+        size_t p99_idx = (n * 99 + 99) / 100 - 1;
+        std::nth_element(latency.begin(), latency.begin() + p99_idx, latency.end());
+
+        CascadePoint& p = points.emplace_back();
+        p.threshold = threshold;
+        p.escalated = static_cast<float>(escalated) / n;
+        p.accuracy = 100.0f * static_cast<float>(correct) / n;
+        p.mean_us = total_us / n;
+        p.p99_us = latency[p99_idx];
+        std::println("{:9.3f} | {:8.2f}% | {:7.2f}% | {:9.2f} | {:8.2f}",
+            p.threshold, 100.0f * p.escalated, p.accuracy, p.mean_us, p.p99_us);
+    }
+    return points;
+}
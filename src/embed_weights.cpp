@@ -0,0 +1,89 @@
+// Build step: turns a saved model (PyTorch style <2i>_weight.bin / <2i>_bias.bin float32 dumps)
+// into a header of aligned constexpr arrays so inference needs no filesystem access.
+//
+// usage: embed_weights <output.h> <model_dir> <layer sizes...>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static std::vector<float> read_exact(const std::filesystem::path& path, size_t count) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) throw std::runtime_error("Cannot open " + path.string());
+    auto bytes = std::filesystem::file_size(path);
+    if (bytes != count * sizeof(float)) {
+        throw std::runtime_error(path.string() + " has " + std::to_string(bytes) + " bytes, expected " + std::to_string(count * sizeof(float)));
+    }
+    std::vector<float> buffer(count);
+    file.read(reinterpret_cast<char*>(buffer.data()), bytes);
+    return buffer;
+}
+
+static void write_array(FILE* out, const char* name, size_t layer, const std::vector<float>& values) {
+    std::fprintf(out, "alignas(64) inline constexpr float %s%zu[%zu] = {", name, layer, values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i % 8 == 0) std::fprintf(out, "\n   ");
+        std::fprintf(out, " %.9ef,", values[i]); // 9 significant digits round-trips a float exactly
+    }
+    std::fprintf(out, "\n};\n\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        std::fprintf(stderr, "usage: %s <output.h> <model_dir> <layer sizes...>\n", argv[0]);
+        return 1;
+    }
+    std::filesystem::path output = argv[1];
+    std::filesystem::path model_dir = argv[2];
+    std::vector<size_t> sizes;
+    for (int i = 3; i < argc; ++i) {
+        char* end = nullptr;
+        unsigned long size = std::strtoul(argv[i], &end, 10);
+        if (!std::isdigit(static_cast<unsigned char>(argv[i][0])) || *end != '\0' || size == 0) {
+            std::fprintf(stderr, "embed_weights: invalid layer size '%s'\n", argv[i]);
+            return 1;
+        }
+        sizes.push_back(size);
+    }
+    size_t layers = sizes.size() - 1;
+
+    try {
+        std::vector<std::vector<float>> weights, biases;
+        for (size_t l = 0; l < layers; ++l) {
+            // PyTorch Sequential numbering: activations sit between the linear layers
+            std::string prefix = std::to_string(2 * l);
+            weights.push_back(read_exact(model_dir / (prefix + "_weight.bin"), sizes[l] * sizes[l + 1]));
+            biases.push_back(read_exact(model_dir / (prefix + "_bias.bin"), sizes[l + 1]));
+        }
+
+        FILE* out = std::fopen(output.string().c_str(), "w");
+        if (!out) throw std::runtime_error("Cannot write " + output.string());
+
+        std::fprintf(out, "#pragma once\n// Generated by embed_weights from %s, do not edit.\n", model_dir.string().c_str());
+        std::fprintf(out, "#include <cstddef>\n\nnamespace embedded_model {\n\n");
+        std::fprintf(out, "inline constexpr std::size_t layer_count = %zu;\n", layers);
+        std::fprintf(out, "inline constexpr std::size_t layer_sizes[%zu] = {", sizes.size());
+        for (size_t i = 0; i < sizes.size(); ++i) std::fprintf(out, "%s%zu", i ? ", " : "", sizes[i]);
+        std::fprintf(out, "};\n\n");
+
+        for (size_t l = 0; l < layers; ++l) {
+            write_array(out, "weight", l, weights[l]);
+            write_array(out, "bias", l, biases[l]);
+        }
+
+        std::fprintf(out, "inline constexpr const float* weights[%zu] = {", layers);
+        for (size_t l = 0; l < layers; ++l) std::fprintf(out, "%sweight%zu", l ? ", " : "", l);
+        std::fprintf(out, "};\ninline constexpr const float* biases[%zu] = {", layers);
+        for (size_t l = 0; l < layers; ++l) std::fprintf(out, "%sbias%zu", l ? ", " : "", l);
+        std::fprintf(out, "};\n\n} // namespace embedded_model\n");
+        std::fclose(out);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "embed_weights: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
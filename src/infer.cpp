@@ -0,0 +1,34 @@
+// Standalone inference executable with the weights compiled in. Reads an idx3 image file
+// (MNIST format) from stdin and prints one predicted digit per line.
+#include "embedded_model.h"
+#include <bit>
+#include <cstdio>
+
+int main() {
+    uint32_t header[4];
+    if (std::fread(header, sizeof(uint32_t), 4, stdin) != 4) {
+        std::fprintf(stderr, "infer: missing idx3 header on stdin\n");
+        return 1;
+    }
+    for (auto& h : header) h = std::byteswap(h);
+    if (header[0] != 2051) {
+        std::fprintf(stderr, "infer: images magic doesnt match\n");
+        return 1;
+    }
+    if (header[2] != 28 || header[3] != 28) {
+        std::fprintf(stderr, "infer: expected %ux%u images\n", 28u, 28u);
+        return 1;
+    }
+
+    uint8_t pixels[IMAGE_SIZE];
+    Image image;
+    for (uint32_t n = 0; n < header[1]; ++n) {
+        if (std::fread(pixels, 1, IMAGE_SIZE, stdin) != IMAGE_SIZE) {
+            std::fprintf(stderr, "infer: truncated input after %u images\n", n);
+            return 1;
+        }
+        for (size_t p = 0; p < IMAGE_SIZE; ++p) image[p] = static_cast<float>(pixels[p]) / 255.0f;
+        std::printf("%u\n", embedded_model::predict(image));
+    }
+    return 0;
+}
@@ -1,8 +1,141 @@
+#include "autotune.h"
+#include "cascade.h"
 #include "loader.h"
 #include "model.h"
+#include "online_model.h"
+#include "prediction_cache.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Trains a single layer model to sit in front of the main one and sweeps the escalation threshold.
+static void run_cascade(const Model& model, const std::vector<LabeledImage>& train, const std::vector<LabeledImage>& test) {
+    std::println("Creating fast model..");
+    Model fast{
+        {784, Activation::None},
+        {10, Activation::Sigmoid},
+    };
+
+    std::println("Training fast model...");
+    fast.fit(train, 2, 32, 1.0f);
+
+    std::println("Testing fast model...");
+    fast.evaluate(test);
+
+    std::println("Cascade threshold sweep...");
+    evaluate_cascade(fast, model, test, {0.0f, 0.05f, 0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.7f, 1.0f});
+}
+
+// Compares the synchronous mini-batch path against Hogwild at increasing thread counts on fresh
+// models, then Hogwild at the tuned thread count. Fresh models take the tuning of model.
+static void run_hogwild(const Model& model, const std::vector<LabeledImage>& train, const std::vector<LabeledImage>& test) {
+    constexpr int epochs = 4;
+    auto fresh = [&] {
+        Model m{
+            {784, Activation::None},
+            {16, Activation::Sigmoid},
+            {16, Activation::Sigmoid},
+            {10, Activation::Sigmoid},
+        };
+        m.set_kernel_tile(model.kernel_tile());
+        m.set_hogwild_threads(model.hogwild_threads());
+        return m;
+    };
+    auto report = [&](const char* name, int threads, const Model& m, std::chrono::steady_clock::duration elapsed) {
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        std::println("{} | Threads: {} | Samples/sec: {:.0f} | Time: {:.2f}s | Test Acc: {:.2f}%",
+            name, threads, epochs * train.size() / seconds, seconds, m.accuracy(test));
+    };
+
+    {
+        Model m = fresh();
+        auto start = std::chrono::steady_clock::now();
+        m.fit(train, epochs, 32, 1.0f);
+        report("Sync", 1, m, std::chrono::steady_clock::now() - start);
+    }
+
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        Model m = fresh();
+        auto start = std::chrono::steady_clock::now();
+        m.fit_hogwild(train, epochs, threads, 0.1f);
+        report("Hogwild", threads, m, std::chrono::steady_clock::now() - start);
+    }
+
+    {
+        Model m = fresh();
+        auto start = std::chrono::steady_clock::now();
+        m.fit_hogwild(train, epochs, 0, 0.1f);
+        report("Hogwild (tuned)", m.hogwild_threads(), m, std::chrono::steady_clock::now() - start);
+    }
+}
+
+// Streams the first half of the test set back as labelled corrections in small batches while a
+// reader thread keeps serving predictions, then scores the untouched second half.
+static void run_online(const Model& model, const std::vector<LabeledImage>& test) {
+    constexpr size_t batch_size = 16;
+    size_t half = test.size() / 2;
+    std::vector<LabeledImage> corrections(test.begin(), test.begin() + half);
+    std::vector<LabeledImage> held_out(test.begin() + half, test.end());
+
+    OnlineModel online(model, batch_size);
+    std::println("Before corrections | Held-out Acc: {:.2f}%", online.current()->accuracy(held_out));
+
+    std::atomic<bool> done{false};
+    std::atomic<size_t> served{0};
+    std::thread reader([&] {
+        while (!done.load(std::memory_order_relaxed)) {
+            for (const auto& sample : held_out) online.predict(sample.image);
+            served.fetch_add(held_out.size(), std::memory_order_relaxed);
+        }
+    });
+
+    double total_us = 0.0, max_us = 0.0;
+    size_t updates = 0;
+    std::vector<LabeledImage> batch;
+    batch.reserve(batch_size);
+    for (size_t i = 0; i < corrections.size(); i += batch_size) {
+        batch.assign(corrections.begin() + i, corrections.begin() + std::min(i + batch_size, corrections.size()));
+        auto start = std::chrono::steady_clock::now();
+        online.partial_fit(batch, 0.5f);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        total_us += us;
+        max_us = std::max(max_us, us);
+        updates++;
+    }
+    done = true;
+    reader.join();
+
+    std::println("Updates: {} | Mean: {:.1f}us | Max: {:.1f}us | Predictions served meanwhile: {}",
+        updates, total_us / updates, max_us, served.load());
+    std::println("After corrections | Held-out Acc: {:.2f}%", online.current()->accuracy(held_out));
+}
+
+// Replays the test set so every image after the first pass is a repeat, on a copy so the
+// other modes keep measuring the uncached model.
+static void run_cache(const Model& model, const std::vector<LabeledImage>& test) {
+    Model cached = model;
+    cached.enable_cache(test.size());
+
+    constexpr int passes = 3;
+    for (int pass = 1; pass <= passes; ++pass) {
+        auto start = std::chrono::steady_clock::now();
+        float acc = cached.accuracy(test);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::println("Pass: {} | Acc: {:.2f}% | Samples/sec: {:.0f}", pass, acc, test.size() / seconds);
+    }
+
+    CacheStats stats = cached.cache()->stats();
+    std::println("Cache | Hits: {} | Misses: {} | Evictions: {} | Size: {}", stats.hits, stats.misses, stats.evictions, stats.size);
+}
+
+int main(int argc, char** argv) {
+    std::string_view mode = argc > 1 ? argv[1] : "";
 
-int main() {
     std::println("Creating model..");
     Model model{
         {784, Activation::None},
@@ -14,13 +147,41 @@ int main() {
     std::println("Loading dataset...");
     auto [train, test] = load_train_test(60000, 10000);
 
+    // tuning is per host and topology, 'prog autotune' refreshes it
+    std::string tuning_path = tuning_cache_path("..");
+    TuningConfig tuning{.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))};
+    if (mode == "autotune") {
+        std::vector<LabeledImage> sample(train.begin(), train.begin() + std::min<size_t>(train.size(), 4000));
+        tuning = autotune(model, sample);
+        save_tuning(tuning_path, model, tuning);
+        std::println("Saved tuning to {}", tuning_path);
+    } else if (auto cached = load_tuning(tuning_path, model)) {
+        tuning = *cached;
+        std::println("Loaded tuning from {} | Kernel tile: {} | Threads: {}",
+            tuning_path, tuning.kernel_tile, tuning.threads);
+    }
+    model.set_kernel_tile(tuning.kernel_tile);
+    model.set_hogwild_threads(tuning.threads);
+
     std::println("Testing before training...");
     model.evaluate(test);
 
     std::println("Training Model...");
-    model.fit(train, 8, 32, 1.0f);
+    if (mode == "validate") {
+        // hold out the tail of the training set and validate every 200 batches on a background thread
+        std::vector<LabeledImage> held_out(train.end() - 5000, train.end());
+        train.resize(train.size() - 5000);
+        model.fit(train, 8, 32, 1.0f, {.data = &held_out, .every_batches = 200, .patience = 5});
+    } else {
+        model.fit(train, 8, 32, 1.0f);
+    }
 
     std::println("Testing after training...");
     model.evaluate(test);
+
+    if (mode == "cache") run_cache(model, test);
+    if (mode == "cascade") run_cascade(model, train, test);
+    if (mode == "online") run_online(model, test);
+    if (mode == "hogwild") run_hogwild(model, train, test);
     return 0;
 }
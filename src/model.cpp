@@ -2,13 +2,23 @@
 #include "activations.h"
 #include "image.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <numeric>
 #include <random>
+#include <stdexcept>
+#include <thread>
 #include <print>
 #include "loader.h"
+#include "prediction_cache.h"
+#include "validator.h"
+
+// Versions are unique across all models so copies that diverge never share cache entries
+static std::atomic<uint64_t> next_version{1};
 
 Model::Model(const std::initializer_list<LayerConfig>& config) {
+    weightsChanged();
     if (config.size() <= 1) return;
     size_t layer_count = config.size();
     weights_.reserve(layer_count - 1);
@@ -64,147 +74,239 @@ Model::Model(const std::initializer_list<LayerConfig>& config) {
     // biases_[2] = b3;
 }
 
-std::vector<TrainHistory> Model::fit(const std::vector<LabeledImage>& train, int epochs, int batch_size, float learning_rate) {
-    std::vector<TrainHistory> history;
-    history.reserve(epochs);
+// Plain parameter reads for the synchronous kernels
+struct PlainLoad {
+    float operator()(const float& x) const { return x; }
+};
+
+// Hogwild reads shared weights that other threads are writing. Relaxed atomics compile to plain
+// loads/stores, they only make the races well defined.
+struct RelaxedLoad {
+    float operator()(const float& x) const { return std::atomic_ref<float>(const_cast<float&>(x)).load(std::memory_order_relaxed); }
+};
+
+static void relaxedStore(float& x, float v) { std::atomic_ref<float>(x).store(v, std::memory_order_relaxed); }
+
+// Computes Tile output neurons at once so each input value is loaded once per tile instead of
+// once per neuron. Each neuron still sums in the same order, so results match any other tile.
+template <size_t Tile, typename Load>
+static void denseSigmoid(const float* w, const float* b, const float* in, float* out, size_t input_size, size_t output_size) {
+    Load load;
+    size_t j = 0;
+    for (; j + Tile <= output_size; j += Tile) {
+        float z[Tile];
+        for (size_t t = 0; t < Tile; ++t) z[t] = load(b[j + t]);
+        for (size_t k = 0; k < input_size; ++k) {
+            float x = in[k];
+            for (size_t t = 0; t < Tile; ++t) z[t] += load(w[(j + t) * input_size + k]) * x;
+        }
+        for (size_t t = 0; t < Tile; ++t) out[j + t] = sigmoid(z[t]);
+    }
+    for (; j < output_size; ++j) {
+        float z = load(b[j]);
+        for (size_t k = 0; k < input_size; ++k) z += load(w[j * input_size + k]) * in[k];
+        out[j] = sigmoid(z);
+    }
+}
 
+template <typename Load>
+static void denseSigmoidTiled(const float* w, const float* b, const float* in, float* out, size_t input_size, size_t output_size, size_t tile) {
+    switch (tile) {
+        case 8: denseSigmoid<8, Load>(w, b, in, out, input_size, output_size); break;
+        case 4: denseSigmoid<4, Load>(w, b, in, out, input_size, output_size); break;
+        case 2: denseSigmoid<2, Load>(w, b, in, out, input_size, output_size); break;
+        default: denseSigmoid<1, Load>(w, b, in, out, input_size, output_size); break;
+    }
+}
+
+void Model::forwardLayer(const float* w, const float* b, const float* in, float* out, size_t input_size, size_t output_size, size_t tile) {
+    denseSigmoidTiled<PlainLoad>(w, b, in, out, input_size, output_size, tile);
+}
+
+void Model::forwardLayerRelaxed(const float* w, const float* b, const float* in, float* out, size_t input_size, size_t output_size, size_t tile) {
+    denseSigmoidTiled<RelaxedLoad>(w, b, in, out, input_size, output_size, tile);
+}
+
+void Model::set_kernel_tile(size_t tile) {
+    if (tile != 1 && tile != 2 && tile != 4 && tile != 8) throw std::invalid_argument("kernel tile must be 1, 2, 4 or 8");
+    kernelTile_ = tile;
+}
+
+// Single pass over a row-major [output x input] weight matrix that both accumulates the weight
+// gradient and back propagates the delta, so the weights are walked once and always with unit
+// stride instead of column-wise. d_prev receives the raw sum (before the activation derivative)
+// and may be null for the input layer.
+void Model::backwardLayer(const float* w, const float* a_in, const float* delta, size_t input_size, size_t output_size,
+    float* w_grad, float* b_grad, float* d_prev) {
+    if (d_prev) std::fill(d_prev, d_prev + input_size, 0.0f);
+
+    for (size_t j = 0; j < output_size; ++j) {
+        float dj = delta[j];
+        b_grad[j] += dj;
+        const float* w_row = w + j * input_size;
+        float* g_row = w_grad + j * input_size;
+        if (d_prev) {
+            for (size_t k = 0; k < input_size; ++k) {
+                d_prev[k] += dj * w_row[k];
+                g_row[k] += dj * a_in[k];
+            }
+        } else {
+            for (size_t k = 0; k < input_size; ++k) g_row[k] += dj * a_in[k];
+        }
+    }
+}
+
+Model::Workspace Model::makeWorkspace() const {
+    Workspace ws;
     size_t num_layers = layerSizes_.size();
 
     // Activations
-    std::vector<std::vector<float>> a(num_layers);
-    for (size_t i = 0; i < num_layers; ++i) a[i].resize(layerSizes_[i]);
+    ws.a.resize(num_layers);
+    for (size_t i = 0; i < num_layers; ++i) ws.a[i].resize(layerSizes_[i]);
 
     // Deltas store the error terms. d[i] correspond to error at layer i + 1
     // d is alligned with weights: d[0] is error for target of weights_[0]
-    std::vector<std::vector<float>> d(num_layers - 1);
-    for (size_t i = 0; i < d.size(); ++i) d[i].resize(a[i + 1].size()); // skip the input layer
+    ws.d.resize(num_layers - 1);
+    for (size_t i = 0; i < ws.d.size(); ++i) ws.d[i].resize(ws.a[i + 1].size()); // skip the input layer
 
     // Gradient Accumulators
-    std::vector<std::vector<float>> w_grad(weights_.size());
-    std::vector<std::vector<float>> b_grad(biases_.size());
+    ws.w_grad.resize(weights_.size());
+    ws.b_grad.resize(biases_.size());
+    for (size_t i = 0; i < ws.w_grad.size(); ++i) {
+        ws.w_grad[i].assign(weights_[i].size(), 0.0f);
+        ws.b_grad[i].assign(biases_[i].size(), 0.0f);
+    }
+    return ws;
+}
+
+// Forward and backward pass for one sample, adding its gradient to the workspace accumulators.
+// Returns the squared error loss of the sample.
+float Model::trainSample(const LabeledImage& sample, Workspace& ws, bool& correct) const {
+    auto& a = ws.a;
+    auto& d = ws.d;
 
-    for (size_t i = 0; i < w_grad.size(); ++i) {
-        w_grad[i].assign(weights_[i].size(), 0.0f);
-        b_grad[i].assign(biases_[i].size(), 0.0f);
+    assert(a[0].size() == IMAGE_SIZE && "first activations should be as big as the image");
+    std::copy(sample.image, sample.image + IMAGE_SIZE, a[0].data());
+
+    for (int l = 0; l < weights_.size(); ++l) {
+        forwardLayer(weights_[l].data(), biases_[l].data(), a[l].data(), a[l + 1].data(), a[l].size(), a[l + 1].size(), kernelTile_);
     }
 
-    float prev_acc = 0.0f;
-    for (int epoch = 1; epoch <= epochs; ++epoch) {
-        float epoch_loss = 0.0f;
-        int correct_predictions = 0;
-        int items_processed = 0;
-        for (size_t idx = 0; idx < train.size(); ++idx) {
-            const auto& sample = train[idx];
-            items_processed++;
+    // compute loss
+    const auto& output = a.back();
+    float sample_loss = 0.0f;
+    uint8_t pred_digit = 0;
+    float max_val = output[0];
 
-            assert(a[0].size() == IMAGE_SIZE && "first activations should be as big as the image");
-            std::copy(sample.image, sample.image + IMAGE_SIZE, a[0].data());
+    assert(output.size() == d.back().size());
 
-            for (int l = 0; l < weights_.size(); ++l) {
-                const auto& w = weights_[l];
-                const auto& b = biases_[l];
-                const auto& input = a[l];
-                auto& output = a[l + 1];
+    for (size_t j = 0; j < output.size(); ++j) {
+        float target = (j == sample.label) ? 1.0f : 0.0f;
+        float error = output[j] - target; // (a - y)
+        sample_loss += error * error;
 
-                size_t input_size = input.size();
-                size_t output_size = output.size();
+        // Compute output layer delta
+        float dC_da = error;
+        float da_dz = output[j] * (1.0f - output[j]);
+        d.back()[j] = dC_da * da_dz;
 
-                for (size_t j = 0; j < output_size; ++j) {
-                    float z = b[j];
-                    for (size_t k = 0; k < input_size; ++k) {
-                        z += w[j * input_size + k] * input[k];
-                    }
-                    output[j] = sigmoid(z);
-                }
+        if (output[j] > max_val) {
+            max_val = output[j];
+            pred_digit = j;
+        }
+    }
+    correct = pred_digit == sample.label;
+
+    // back prop and gradient accumulation, one fused sweep per layer from the output down
+    assert(weights_.size() + 1 == a.size() && "d must be 1 smaller than activations");
+    for (int l = (int)weights_.size() - 1; l >= 0; --l) {
+        float* d_prev = l > 0 ? d[l - 1].data() : nullptr; // the input layer needs no delta
+        backwardLayer(weights_[l].data(), a[l].data(), d[l].data(), a[l].size(), d[l].size(),
+            ws.w_grad[l].data(), ws.b_grad[l].data(), d_prev);
+        if (d_prev) {
+            const auto& a_curr = a[l]; // because they are not alligned (and input layer misaligns them)
+            for (size_t k = 0; k < a_curr.size(); ++k) {
+                float da_dz = a_curr[k] * (1.0f - a_curr[k]);
+                d_prev[k] *= da_dz;
             }
+        }
+    }
+    return sample_loss;
+}
 
-            // compute loss
-            const auto& output = a.back();
-            float sample_loss = 0.0f;
-            uint8_t pred_digit = 0;
-            float max_val = output[0];
+// Descends along the accumulated gradients and clears them for the next batch
+void Model::applyGradients(Workspace& ws, float scaler) {
+    for (size_t l = 0; l < weights_.size(); ++l) {
+        size_t w_size = weights_[l].size();
+        size_t b_size = biases_[l].size();
 
-            assert(output.size() == d.back().size());
+        for (size_t w = 0; w < w_size; ++w) {
+            weights_[l][w] -= ws.w_grad[l][w] * scaler;
+            ws.w_grad[l][w] = 0.0f;
+        }
+        for (size_t b = 0; b < b_size; ++b) {
+            biases_[l][b] -= ws.b_grad[l][b] * scaler;
+            ws.b_grad[l][b] = 0.0f;
+        }
+    }
+    weightsChanged();
+}
 
-            for (size_t j = 0; j < output.size(); ++j) {
-                float target = (j == sample.label) ? 1.0f : 0.0f;
-                float error = output[j] - target; // (a - y)
-                sample_loss += error * error;
-
-                // Compute output layer delta
-                float dC_da = error;
-                float da_dz = output[j] * (1.0f - output[j]);
-                d.back()[j] = dC_da * da_dz;
-
-                if (output[j] > max_val) {
-                    max_val = output[j];
-                    pred_digit = j;
-                }
-            }
-            epoch_loss += sample_loss;
-            if (pred_digit == sample.label) correct_predictions++;
-
-            // back prop, finding rest of deltas (i swapped j k here)
-            for (int i = (int)d.size() - 2; i >= 0; --i) {
-                const auto& w_next = weights_[i + 1];
-                const auto& a_curr = a[i + 1]; // because they are not alligned (and input layer misaligns them)
-                const auto& d_next = d[i + 1];
-                auto& d_curr = d[i];
-
-                for (size_t k = 0; k < d_curr.size(); ++k) {
-                    float error_sum = 0.0f;
-                    for (size_t j = 0; j < d_next.size(); ++j) {
-                        float dz_da = w_next[j * d_curr.size() + k];
-                        error_sum += d_next[j] * dz_da;
-                    }
-                    float da_dz = a_curr[k] * (1.0f - a_curr[k]);
-                    d_curr[k] = error_sum * da_dz;
-                }
-            }
+std::vector<TrainHistory> Model::fit(const std::vector<LabeledImage>& train, int epochs, int batch_size, float learning_rate,
+    const ValidationConfig& validation) {
+    std::vector<TrainHistory> history;
+    history.reserve(epochs);
 
-            // accumulate gradients over the batch
-            assert(weights_.size() + 1 == a.size() && "d must be 1 smaller than activations");
-            for (int l = 0; l < weights_.size(); ++l) {
-                size_t input_cols = a[l].size();
-                size_t output_rows = d[l].size();
+    std::unique_ptr<AsyncValidator> validator;
+    if (validation.data) validator = std::make_unique<AsyncValidator>(*validation.data, validation.patience);
+    int batches = 0;
+    bool stopped_early = false;
+    bool validated_latest = false; // the current weights have already been submitted
+    int last_epoch = 0;
 
-                for (int j = 0; j < output_rows; ++j) {
-                    float delta = d[l][j];
-                    b_grad[l][j] += delta;
+    Workspace ws = makeWorkspace();
 
-                    for (int k = 0; k < input_cols; ++k) {
-                        float dz_dw = a[l][k];
-                        float grad_w = delta * dz_dw; // gradient for current w for j in next layer from k in prev layer
-                        w_grad[l][j * input_cols + k] += grad_w;
-                    }
-                }
-            }
+    // Track the best accuracy we ever seen during this call
+    float best_acc = 0.0f;
+    int no_improve = 0;
 
-            if (items_processed >= batch_size || idx == train.size() - 1) {
-                float scaler = learning_rate / static_cast<float>(items_processed);
+    for (int epoch = 1; epoch <= epochs; ++epoch) {
+        last_epoch = epoch;
+        float epoch_loss = 0.0f;
+        int correct_predictions = 0;
+        int items_processed = 0;
+        for (size_t idx = 0; idx < train.size(); ++idx) {
+            const auto& sample = train[idx];
+            items_processed++;
 
-                for (size_t l = 0; l < weights_.size(); ++l) {
-                    float w_size = weights_[l].size();
-                    float b_size = biases_[l].size();
+            bool correct = false;
+            epoch_loss += trainSample(sample, ws, correct);
+            if (correct) correct_predictions++;
 
-                    for (size_t w = 0; w < w_size; ++w) {
-                        weights_[l][w] -= w_grad[l][w] * scaler;
-                        w_grad[l][w] = 0.0f;
-                    }
-                    for (size_t b = 0; b < b_size; ++b) {
-                        biases_[l][b] -= b_grad[l][b] * scaler;
-                        b_grad[l][b] = 0.0f;
+            if (items_processed >= batch_size || idx == train.size() - 1) {
+                applyGradients(ws, learning_rate / static_cast<float>(items_processed));
+                items_processed = 0;
+                batches++;
+                validated_latest = false;
+
+                if (validator && validation.every_batches > 0 && batches % validation.every_batches == 0) {
+                    validator->submit(snapshot(), epoch, batches);
+                    validated_latest = true;
+                    if (validator->should_stop()) {
+                        stopped_early = true;
+                        break;
                     }
                 }
-                items_processed = 0;
             }
         }
 
-        float acc = 100.0f * static_cast<float>(correct_predictions) / train.size();
+        if (stopped_early) break; // mid-epoch, the epoch stats would only cover part of the data
+        if (validator && validation.every_batches <= 0 && epoch % std::max(validation.every_epochs, 1) == 0) {
+            validator->submit(snapshot(), epoch, batches);
+            validated_latest = true;
+        }
 
-        // Track the best accuracy we ever seen
-        static float best_acc = 0.0f;
-        static int no_improve = 0;
+        float acc = 100.0f * static_cast<float>(correct_predictions) / train.size();
 
         // Check if we improved by at least a small amount
         float min_improvement = 0.3f;
@@ -220,31 +322,176 @@ std::vector<TrainHistory> Model::fit(const std::vector<LabeledImage>& train, int
 
                 if (learning_rate < 0.01f) {
                     std::println("No improvement after many halvings.");
-                    return history;
+                    break;
                 }
             }
         }
 
         std::println("Epoch: {} | Loss: {:.4f} | Acc: {:.2f}%", epoch, epoch_loss / train.size(), acc);
         history.push_back({epoch, epoch_loss, acc});
+
+        if (validator && validator->should_stop()) {
+            stopped_early = true;
+            break;
+        }
+    }
+
+    if (validator) {
+        // the training since the last submit may have produced the best weights
+        if (!validated_latest) validator->submit(snapshot(), last_epoch, batches);
+        auto best = validator->finish();
+        if (stopped_early) std::println("Validation stopped improving. Stopping early.");
+        if (validation.restore_best && best) {
+            weights_ = best->weights_;
+            biases_ = best->biases_;
+            weightsChanged();
+            std::println("Restored best weights | Val Acc: {:.2f}%", validator->best_accuracy());
+        }
     }
     return history;
 }
 
 
 
+float Model::partial_fit(const std::vector<LabeledImage>& batch, float learning_rate) {
+    if (batch.empty()) return 0.0f;
+    Workspace ws = makeWorkspace();
+    float loss = 0.0f;
+    for (const auto& sample : batch) {
+        bool correct = false;
+        loss += trainSample(sample, ws, correct);
+    }
+    applyGradients(ws, learning_rate / static_cast<float>(batch.size()));
+    return loss / static_cast<float>(batch.size());
+}
+
+std::vector<TrainHistory> Model::fit_hogwild(const std::vector<LabeledImage>& train, int epochs, int threads, float learning_rate) {
+    std::vector<TrainHistory> history;
+    history.reserve(epochs);
+    if (train.empty()) return history;
+    if (threads <= 0) threads = hogwildThreads_;
+
+    std::vector<uint32_t> order(train.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::mt19937 gen(std::random_device{}());
+
+    RelaxedLoad load;
+    auto worker = [&](size_t begin, size_t end, float& loss_out, int& correct_out) {
+        // the gradient accumulators go unused, updates are applied per sample
+        Workspace ws = makeWorkspace();
+        auto& a = ws.a;
+        auto& d = ws.d;
+
+        float loss = 0.0f;
+        int correct = 0;
+        for (size_t idx = begin; idx < end; ++idx) {
+            const auto& sample = train[order[idx]];
+            std::copy(sample.image, sample.image + IMAGE_SIZE, a[0].data());
+
+            for (size_t l = 0; l < weights_.size(); ++l) {
+                forwardLayerRelaxed(weights_[l].data(), biases_[l].data(), a[l].data(), a[l + 1].data(), a[l].size(), a[l + 1].size(), kernelTile_);
+            }
+
+            const auto& output = a.back();
+            uint8_t pred_digit = 0;
+            for (size_t j = 0; j < output.size(); ++j) {
+                float error = output[j] - ((j == sample.label) ? 1.0f : 0.0f);
+                loss += error * error;
+                d.back()[j] = error * output[j] * (1.0f - output[j]);
+                if (output[j] > output[pred_digit]) pred_digit = j;
+            }
+            if (pred_digit == sample.label) correct++;
+
+            // fused sweep: each weight is read for the previous delta and updated in the same pass,
+            // the delta still sees the value from before this sample's update
+            for (int l = (int)weights_.size() - 1; l >= 0; --l) {
+                size_t input_cols = a[l].size();
+                const float* a_in = a[l].data();
+                float* d_prev = l > 0 ? d[l - 1].data() : nullptr;
+                if (d_prev) std::fill(d_prev, d_prev + input_cols, 0.0f);
+
+                for (size_t j = 0; j < d[l].size(); ++j) {
+                    float delta = d[l][j];
+                    float step = learning_rate * delta;
+                    relaxedStore(biases_[l][j], load(biases_[l][j]) - step);
+                    float* row = weights_[l].data() + j * input_cols;
+                    for (size_t k = 0; k < input_cols; ++k) {
+                        float w = load(row[k]);
+                        if (d_prev) d_prev[k] += delta * w;
+                        relaxedStore(row[k], w - step * a_in[k]);
+                    }
+                }
+                if (d_prev) {
+                    for (size_t k = 0; k < input_cols; ++k) d_prev[k] *= a_in[k] * (1.0f - a_in[k]);
+                }
+            }
+        }
+        loss_out = loss;
+        correct_out = correct;
+    };
+
+    std::vector<float> losses(threads);
+    std::vector<int> corrects(threads);
+    for (int epoch = 1; epoch <= epochs; ++epoch) {
+        std::shuffle(order.begin(), order.end(), gen);
+
+        std::vector<std::thread> pool;
+        pool.reserve(threads);
+        for (int t = 0; t < threads; ++t) {
+            size_t begin = train.size() * t / threads;
+            size_t end = train.size() * (t + 1) / threads;
+            pool.emplace_back(worker, begin, end, std::ref(losses[t]), std::ref(corrects[t]));
+        }
+        for (auto& th : pool) th.join();
+        weightsChanged();
+
+        float epoch_loss = std::accumulate(losses.begin(), losses.end(), 0.0f);
+        int correct_predictions = std::accumulate(corrects.begin(), corrects.end(), 0);
+        float acc = 100.0f * static_cast<float>(correct_predictions) / train.size();
+        std::println("Epoch: {} | Threads: {} | Loss: {:.4f} | Acc: {:.2f}%", epoch, threads, epoch_loss / train.size(), acc);
+        history.push_back({epoch, epoch_loss, acc});
+    }
+    return history;
+}
+
 uint8_t Model::predict(const Image& im) const {
+    return classify(im).digit;
+}
+
+Prediction Model::classify(const Image& im) const {
+    if (!cache_) return classifyUncached(im);
+    uint64_t hash = PredictionCache::hash(im);
+    if (auto hit = cache_->lookup(im, hash, version_)) return *hit;
+    Prediction p = classifyUncached(im);
+    cache_->insert(im, hash, version_, p);
+    return p;
+}
+
+Prediction Model::classifyUncached(const Image& im) const {
     auto result = forwardPass(im);
     assert(result.size() == 10 && "should be 10");
     uint8_t maxDigit = 0;
     float maxScore = result[0];
+    float secondScore = -INFINITY;
     for (size_t i = 1; i < result.size(); ++i) {
         if (result[i] > maxScore) {
+            secondScore = maxScore;
             maxScore = result[i];
             maxDigit = i;
+        } else if (result[i] > secondScore) {
+            secondScore = result[i];
         }
     }
-    return maxDigit;
+    return {maxDigit, maxScore - secondScore};
+}
+
+float Model::accuracy(const std::vector<LabeledImage>& test) const {
+    if (test.empty()) return 0.0f;
+    int correct = 0;
+    for (const auto& sample : test) {
+        if (predict(sample.image) == sample.label) correct++;
+    }
+    return 100.0f * static_cast<float>(correct) / static_cast<float>(test.size());
 }
 
 void Model::evaluate(const std::vector<LabeledImage>& test) const {
@@ -260,6 +507,20 @@ void Model::evaluate(const std::vector<LabeledImage>& test) const {
     std::println("{}/{} ({}%)", correct, total, 100.f * (float)correct / (float)total);
 }
 
+void Model::enable_cache(size_t capacity, size_t shards) {
+    cache_ = std::make_shared<PredictionCache>(capacity, shards);
+}
+
+std::shared_ptr<const Model> Model::snapshot() const {
+    auto copy = std::make_shared<Model>(*this);
+    copy->cache_.reset(); // keep validation traffic out of the serving cache
+    return copy;
+}
+
+void Model::weightsChanged() {
+    version_ = next_version.fetch_add(1, std::memory_order_relaxed);
+}
+
 std::vector<float> Model::forwardPass(const Image& image) const {
     size_t layers = layerSizes_.size();
     std::vector<float> a(layerSizes_[0]);
@@ -268,13 +529,7 @@ std::vector<float> Model::forwardPass(const Image& image) const {
 
     for (int l = 1; l < layers; ++l) {
         std::vector<float> next_a(layerSizes_[l]);
-        for (size_t j = 0; j < next_a.size(); ++j) {
-            float z = biases_[l - 1][j];
-            for (size_t k = 0; k < a.size(); ++k) {
-                z += weights_[l - 1][j * a.size() + k] * a[k];
-            }
-            next_a[j] = sigmoid(z);
-        }
+        forwardLayer(weights_[l - 1].data(), biases_[l - 1].data(), a.data(), next_a.data(), a.size(), next_a.size(), kernelTile_);
         a = std::move(next_a);
     }
     return a;
@@ -0,0 +1,19 @@
+#include "online_model.h"
+#include <stdexcept>
+
+OnlineModel::OnlineModel(const Model& initial, size_t max_batch)
+    : front_(std::make_shared<Model>(initial)), back_(std::make_shared<Model>(initial)), max_batch_(max_batch) {}
+
+float OnlineModel::partial_fit(const std::vector<LabeledImage>& batch, float learning_rate) {
+    if (batch.size() > max_batch_) throw std::invalid_argument("partial_fit batch is larger than max_batch");
+
+    std::lock_guard lock(writer_);
+    float loss = back_->partial_fit(batch, learning_rate);
+
+    // Publish the trained buffer and start the next update from a fresh copy of it. The old
+    // front is released once its last reader drops it.
+    std::shared_ptr<Model> published = back_;
+    back_ = std::make_shared<Model>(*published);
+    front_.store(std::move(published), std::memory_order_release);
+    return loss;
+}
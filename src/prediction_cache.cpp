@@ -0,0 +1,103 @@
+#include "prediction_cache.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+PredictionCache::PredictionCache(size_t capacity, size_t shards)
+    : shard_count_(std::max<size_t>(shards, 1)), shards_(std::make_unique<Shard[]>(shard_count_)) {
+    shard_capacity_ = std::max<size_t>((capacity + shard_count_ - 1) / shard_count_, 1);
+}
+
+uint64_t PredictionCache::hash(const Image& im) {
+    // Four independent multiply-rotate lanes over the raw float bits, 8 bytes at a time
+    static_assert(sizeof(Image) % 32 == 0, "image must split evenly into lanes");
+    constexpr uint64_t k = 0x9E3779B97F4A7C15ull;
+    const auto* bytes = reinterpret_cast<const unsigned char*>(im);
+    uint64_t h[4] = {k, k ^ 1, k ^ 2, k ^ 3};
+    for (size_t i = 0; i < sizeof(Image); i += 32) {
+        for (int lane = 0; lane < 4; ++lane) {
+            uint64_t w;
+            std::memcpy(&w, bytes + i + lane * 8, 8);
+            h[lane] = std::rotl((h[lane] ^ w) * k, 31);
+        }
+    }
+    uint64_t r = h[0] ^ std::rotl(h[1], 16) ^ std::rotl(h[2], 32) ^ std::rotl(h[3], 48);
+    r ^= r >> 33;
+    r *= 0xFF51AFD7ED558CCDull;
+    r ^= r >> 33;
+    return r;
+}
+
+std::optional<Prediction> PredictionCache::lookup(const Image& im, uint64_t hash, uint64_t version) {
+    Shard& s = shard_for(hash);
+    std::lock_guard lock(s.mutex);
+    auto it = s.index.find(hash);
+    if (it == s.index.end()) {
+        s.misses++;
+        return std::nullopt;
+    }
+    auto entry = it->second;
+    if (entry->version != version) {
+        // computed with weights that no longer exist
+        s.index.erase(it);
+        s.lru.erase(entry);
+        s.misses++;
+        return std::nullopt;
+    }
+    if (std::memcmp(entry->pixels.data(), im, sizeof(Image)) != 0) {
+        s.misses++;
+        return std::nullopt;
+    }
+    s.lru.splice(s.lru.begin(), s.lru, entry);
+    s.hits++;
+    return entry->prediction;
+}
+
+void PredictionCache::insert(const Image& im, uint64_t hash, uint64_t version, Prediction prediction) {
+    Shard& s = shard_for(hash);
+    std::lock_guard lock(s.mutex);
+    auto it = s.index.find(hash);
+    if (it != s.index.end()) {
+        // same key or a collision, either way the newest entry wins
+        auto entry = it->second;
+        std::memcpy(entry->pixels.data(), im, sizeof(Image));
+        entry->version = version;
+        entry->prediction = prediction;
+        s.lru.splice(s.lru.begin(), s.lru, entry);
+        return;
+    }
+    if (s.lru.size() >= shard_capacity_) {
+        // recycle the least recently used node instead of allocating a new one
+        s.index.erase(s.lru.back().hash);
+        s.lru.splice(s.lru.begin(), s.lru, std::prev(s.lru.end()));
+        s.evictions++;
+    } else {
+        s.lru.emplace_front();
+    }
+    Entry& e = s.lru.front();
+    std::memcpy(e.pixels.data(), im, sizeof(Image));
+    e.hash = hash;
+    e.version = version;
+    e.prediction = prediction;
+    s.index.emplace(hash, s.lru.begin());
+}
+
+void PredictionCache::clear() {
+    for (size_t i = 0; i < shard_count_; ++i) {
+        std::lock_guard lock(shards_[i].mutex);
+        shards_[i].lru.clear();
+        shards_[i].index.clear();
+    }
+}
+
+CacheStats PredictionCache::stats() const {
+    CacheStats total{};
+    for (size_t i = 0; i < shard_count_; ++i) {
+        std::lock_guard lock(shards_[i].mutex);
+        total.hits += shards_[i].hits;
+        total.misses += shards_[i].misses;
+        total.evictions += shards_[i].evictions;
+        total.size += shards_[i].lru.size();
+    }
+    return total;
+}
@@ -0,0 +1,62 @@
+#include "validator.h"
+#include "model.h"
+#include <print>
+
+AsyncValidator::AsyncValidator(const std::vector<LabeledImage>& data, int patience)
+    : data_(data), patience_(patience), thread_(&AsyncValidator::run, this) {}
+
+AsyncValidator::~AsyncValidator() {
+    finish();
+}
+
+void AsyncValidator::submit(std::shared_ptr<const Model> snapshot, int epoch, int batch) {
+    {
+        std::lock_guard lock(mutex_);
+        pending_ = {std::move(snapshot), epoch, batch}; // drops an older snapshot not yet picked up
+    }
+    cv_.notify_one();
+}
+
+bool AsyncValidator::should_stop() const {
+    std::lock_guard lock(mutex_);
+    return stop_;
+}
+
+std::shared_ptr<const Model> AsyncValidator::finish() {
+    {
+        std::lock_guard lock(mutex_);
+        done_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) thread_.join();
+    std::lock_guard lock(mutex_);
+    return best_;
+}
+
+float AsyncValidator::best_accuracy() const {
+    std::lock_guard lock(mutex_);
+    return best_acc_;
+}
+
+void AsyncValidator::run() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [&] { return pending_.snapshot || done_; });
+        if (!pending_.snapshot) return; // done and nothing left to score
+        Job job = std::move(pending_);
+        pending_ = {};
+
+        lock.unlock();
+        float acc = job.snapshot->accuracy(data_);
+        lock.lock();
+
+        if (acc > best_acc_) {
+            best_acc_ = acc;
+            best_ = job.snapshot;
+            no_improve_ = 0;
+        } else if (patience_ > 0 && ++no_improve_ >= patience_) {
+            stop_ = true;
+        }
+        std::println("Validation | Epoch: {} | Batch: {} | Acc: {:.2f}% | Best: {:.2f}%", job.epoch, job.batch, acc, best_acc_);
+    }
+}